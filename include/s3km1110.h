@@ -6,13 +6,28 @@
 
 // #define S3KM1110_DEBUG_COMMANDS
 // #define S3KM1110_DEBUG_DATA
+// #define S3KM1110_DEBUG_BINARY      // Write data frames as binary records instead of text, see tools/s3km1110_decode.py
+// #define S3KM1110_DEBUG_BINARY_RAW  // Same, but records carry the raw frame bytes instead of decoded values
 // #define S3KM1110_SKIP_READ_CONFIG_ON_BEGIN
 
+#if defined(S3KM1110_DEBUG_BINARY_RAW) && !defined(S3KM1110_DEBUG_BINARY)
+#define S3KM1110_DEBUG_BINARY
+#endif
+
+#if defined(S3KM1110_DEBUG_BINARY) && defined(S3KM1110_DEBUG_DATA)
+#undef S3KM1110_DEBUG_DATA  // Binary records replace the text frame dump
+#endif
+
 struct s3km1110ConfigParameters
 {
     uint8_t detectionGatesMin = 0;   // Minimum detection distance gate | 0~15 | 
     uint8_t detectionGatesMax = 0;   // Maximum detection distance gate | 0~15
     uint16_t targetDisappearanceDelay = 0;  // Time (seconds) to confirm absence after target loss | 0~65535
+
+    // Per distance gate (0~15) thresholds, read with readRadarConfigThresholds()
+    uint32_t motionTriggerThreshold[16] = {0};  // Sensitivity for initial movement detection | 0~2^31-1
+    uint32_t motionHoldThreshold[16] = {0};     // Sensitivity for maintaining presence state | 0~2^31-1
+    uint32_t microMotionThreshold[16] = {0};    // Sensitivity for stationary/breathing detection | 0~2^31-1
 };
 
 class s3km1110 {
@@ -24,6 +39,14 @@ class s3km1110 {
         static constexpr size_t kMaxFrameLength = 45;
         static constexpr size_t kDistanceGateCount = 16;
 
+        // Bits of the mask reported by applyRadarConfiguration(). Thresholds use one bit per gate, starting from gate 0
+        static constexpr uint64_t kConfigMinimumGates = 1ULL << 0;
+        static constexpr uint64_t kConfigMaximumGates = 1ULL << 1;
+        static constexpr uint64_t kConfigTargetDisappearanceDelay = 1ULL << 2;
+        static constexpr uint64_t kConfigMotionTriggerThresholds = 0xFFFFULL << 3;
+        static constexpr uint64_t kConfigMotionHoldThresholds = 0xFFFFULL << 19;
+        static constexpr uint64_t kConfigMicroMotionThresholds = 0xFFFFULL << 35;
+
         bool begin(Stream &dataStream, Stream &debugStream);
         bool isActive();    // Is the sensor sending data regularly
         bool read();        // You must call this frequently in your main loop to process incoming frames from the sensor
@@ -35,15 +58,23 @@ class s3km1110 {
         bool readRadarConfigMinimumGates();
         bool readRadarConfigMaximumGates();
         bool readRadarConfigTargetDisappearanceDelay();
+        bool readRadarConfigThresholds();   // Read all per gate thresholds in one command session
 
         bool setRadarConfigurationMinimumGates(uint8_t);
         bool setRadarConfigurationMaximumGates(uint8_t);
         bool setRadarConfigurationTargetDisappearanceDelay(uint16_t);
 
+        // Bring the radar to the desired configuration in one command session.
+        // Only parameters that differ from the values confirmed by the radar are sent and each of them is read back to verify it.
+        // If any parameter was never confirmed by a read or set, nothing is written and the call fails, unless
+        // isOverwritingUnconfirmed is set: then those are read from the radar first and written if they differ.
+        // changedParameters receives the kConfig* bits of the parameters that were changed.
+        bool applyRadarConfiguration(const s3km1110ConfigParameters &desired, uint64_t *changedParameters = nullptr, bool isOverwritingUnconfirmed = false);
+
         String firmwareVersion;
         String serialNumber;
 
-        s3km1110ConfigParameters radarConfiguration;
+        s3km1110ConfigParameters radarConfiguration;    // Mirror of the radar configuration, changing it does not affect the radar
 
         bool isTargetDetected = false;
         int16_t distanceToTarget = -1;  // Distance to the target in centimetres.
@@ -76,10 +107,10 @@ class s3km1110 {
             // 0x02,
             // 0x03,
             DisappearanceDelay  = 0x04,
-            PowerSupplyAlarm    = 0x05
-            // 0x10 ~ 0x1F      // Motion Trigger Threshold | Sensitivity for initial movement detection (Gates 0-15) | 0 to 2^(32-1)
-            // 0x20 ~ 0x2F      // Motion Hold Threshold | Sensitivity for maintaining presence state (Gates 0-15) | 0 to 2^(32-1)
-            // 0x30 ~ 0x3F      // Micro-motion Threshold | Sensitivity for stationary/breathing detection (Gates 0-15) | 0 to 2^(32-1)
+            PowerSupplyAlarm    = 0x05,
+            MotionTriggerThreshold  = 0x10,     // 0x10 ~ 0x1F | Sensitivity for initial movement detection (Gates 0-15) | 0 to 2^(32-1)
+            MotionHoldThreshold     = 0x20,     // 0x20 ~ 0x2F | Sensitivity for maintaining presence state (Gates 0-15) | 0 to 2^(32-1)
+            MicroMotionThreshold    = 0x30      // 0x30 ~ 0x3F | Sensitivity for stationary/breathing detection (Gates 0-15) | 0 to 2^(32-1)
         };
 
         enum class RadarMode : uint8_t {
@@ -88,6 +119,15 @@ class s3km1110 {
             Running = 0x64
         };
 
+        // Binary debug record: A5 5A | type | payload length | payload | checksum (sum of type, length and payload)
+        static constexpr uint8_t kDebugRecordSync1 = 0xA5;
+        static constexpr uint8_t kDebugRecordSync2 = 0x5A;
+
+        enum class DebugRecordType : uint8_t {
+            DataFrame   = 0x01,     // millis u32 | detected u8 | distance i16 | gate energy u16 x 16
+            RawFrame    = 0x02      // millis u32 | frame bytes
+        };
+
     private:
         Stream *_uartRadar = nullptr;
         Stream *_uartDebug = nullptr;
@@ -106,8 +146,13 @@ class s3km1110 {
         ConfigParam _lastRadarConfigCommand;
         bool _isLatestCommandSuccess = false;
 
+        static constexpr uint8_t kConfigParameterCount = 3 + 3 * kDistanceGateCount;
+        s3km1110ConfigParameters _confirmedRadarConfiguration;  // Values confirmed by the radar, radarConfiguration mirrors it
+        uint64_t _radarConfigurationKnown = 0;                  // kConfig* bits of _confirmedRadarConfiguration values
+
         bool _enableReportMode();
         void _printCurrentFrame();
+        void _writeDebugRecord(DebugRecordType type, const uint8_t *payload, uint8_t length);
 
         bool _read_frame();
         bool _isDataFrameComplete();
@@ -118,7 +163,14 @@ class s3km1110 {
 
         bool _sendCommandAndWait(RadarCommand command, uint32_t payload, uint8_t payloadSize, bool isSkipCommandMode = false);
         bool _sendCommandAndWait(uint16_t, uint32_t, uint8_t, uint32_t, uint8_t, bool isSkipCommandMode = false);
-        bool _setParameterConfiguration(uint16_t parameter, int value);
+        bool _setParameterConfiguration(uint16_t parameter, uint32_t value, bool isSkipCommandMode = false);
+        bool _readParameterConfiguration(uint16_t parameter, bool isSkipCommandMode = false);
+
+        void _confirmConfigParameter(uint8_t index, uint32_t value);
+        int8_t _configParameterIndex(uint16_t parameter);
+        uint16_t _configParameterCode(uint8_t index);
+        uint32_t _configParameterValue(const s3km1110ConfigParameters &config, uint8_t index);
+        void _setConfigParameterValue(s3km1110ConfigParameters &config, uint8_t index, uint32_t value);
 
         bool _openCommandMode();
         bool _closeCommandMode();
@@ -126,4 +178,88 @@ class s3km1110 {
         void _writeLittleEndian(uint8_t *buffer, uint8_t &index, uint32_t value, uint8_t byteCount);
 };
 
+struct s3km1110GateSummary
+{
+    uint16_t min = 0;
+    uint16_t max = 0;
+    uint16_t mean = 0;
+    float variance = 0;
+};
+
+struct s3km1110WindowSummary
+{
+    uint32_t windowStart = 0;       // millis() at the start of the window
+    uint32_t windowDuration = 0;    // Window length in milliseconds
+    uint32_t frameCount = 0;        // Data frames received in the window
+    uint32_t presenceFrameCount = 0; // Frames with a detected target
+    float presenceDutyCycle = 0;    // presenceFrameCount / frameCount | 0~1
+
+    // Distance statistics over frames with a detected target, -1 when there were none
+    int16_t distanceMin = -1;
+    int16_t distanceMax = -1;
+    int16_t distanceMean = -1;
+    float distanceVariance = 0;
+
+    s3km1110GateSummary gates[s3km1110::kDistanceGateCount];
+};
+
+// Incremental aggregation of data frames over tumbling or sliding windows.
+// A window is made of `windowDuration / hopDuration` panes; each frame is folded into the current pane in O(1)
+// and panes are merged only when a window closes. All storage is fixed-size, nothing is allocated.
+class s3km1110Aggregator {
+
+    public:
+        static constexpr uint8_t kMaxWindowPanes = 8;
+
+        // hopDuration == 0 (or == windowDuration) gives a tumbling window.
+        // windowDuration must be a multiple of hopDuration with at most kMaxWindowPanes panes.
+        bool begin(uint32_t windowDuration, uint32_t hopDuration = 0);
+        void reset();
+
+        // Closed windows are queued and handed out one per call: update() and flush() return true and fill `summary`
+        // while any is pending. Call flush() until it returns false to drain the queue.
+        bool update(const s3km1110 &radar);   // Call after each successful radar.read()
+        bool update(const s3km1110 &radar, uint32_t now);
+        bool flush();                         // Also closes windows that ended without a new frame, e.g. when the radar goes quiet
+        bool flush(uint32_t now);
+
+        s3km1110WindowSummary summary;        // Oldest pending window, valid after update() or flush() returned true
+        uint32_t droppedSummaries = 0;        // Windows lost because the queue was not drained in time
+
+    private:
+        struct Pane
+        {
+            uint32_t frames;
+            uint32_t presenceFrames;
+            int16_t distanceMin;
+            int16_t distanceMax;
+            uint64_t distanceSum;
+            uint64_t distanceSumSquares;
+            uint16_t gateMin[s3km1110::kDistanceGateCount];
+            uint16_t gateMax[s3km1110::kDistanceGateCount];
+            uint64_t gateSum[s3km1110::kDistanceGateCount];
+            uint64_t gateSumSquares[s3km1110::kDistanceGateCount];
+        };
+
+        Pane _panes[kMaxWindowPanes];
+        uint8_t _paneCount = 0;
+        uint8_t _paneIndex = 0;
+        uint8_t _filledPanes = 0;
+
+        // One update can close at most kMaxWindowPanes windows that still contain frames
+        s3km1110WindowSummary _pendingSummaries[kMaxWindowPanes];
+        uint8_t _pendingHead = 0;
+        uint8_t _pendingCount = 0;
+
+        uint32_t _hopDuration = 0;
+        uint32_t _paneStart = 0;
+        bool _isStarted = false;
+
+        void _advance(uint32_t now);
+        bool _popSummary();
+        void _clearPane(Pane &pane);
+        void _closePane();
+        void _buildSummary();
+};
+
 #endif // s3km1110_h
\ No newline at end of file
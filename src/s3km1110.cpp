@@ -68,7 +68,7 @@ bool s3km1110::setRadarConfigurationMinimumGates(uint8_t gates)
 {
     uint8_t newValue = max((uint8_t)0, min((uint8_t)15, gates));
     bool isSuccess = _setParameterConfiguration(static_cast<uint16_t>(ConfigParam::MinDistance), newValue);
-    if (isSuccess) { radarConfiguration.detectionGatesMin = newValue; }
+    if (isSuccess) { _confirmConfigParameter(_configParameterIndex(static_cast<uint16_t>(ConfigParam::MinDistance)), newValue); }
     return isSuccess;
 }
 
@@ -76,14 +76,85 @@ bool s3km1110::setRadarConfigurationMaximumGates(uint8_t gates)
 {
     uint8_t newValue = max((uint8_t)0, min((uint8_t)15, gates));
     bool isSuccess = _setParameterConfiguration(static_cast<uint16_t>(ConfigParam::MaxDistance), newValue);
-    if (isSuccess) { radarConfiguration.detectionGatesMax = newValue; }
+    if (isSuccess) { _confirmConfigParameter(_configParameterIndex(static_cast<uint16_t>(ConfigParam::MaxDistance)), newValue); }
     return isSuccess;
 }
 
 bool s3km1110::setRadarConfigurationTargetDisappearanceDelay(uint16_t delay)
 {
     bool isSuccess = _setParameterConfiguration(static_cast<uint16_t>(ConfigParam::DisappearanceDelay), delay);
-    if (isSuccess) { radarConfiguration.targetDisappearanceDelay = delay; }
+    if (isSuccess) { _confirmConfigParameter(_configParameterIndex(static_cast<uint16_t>(ConfigParam::DisappearanceDelay)), delay); }
+    return isSuccess;
+}
+
+bool s3km1110::applyRadarConfiguration(const s3km1110ConfigParameters &desired, uint64_t *changedParameters, bool isOverwritingUnconfirmed)
+{
+    if (changedParameters != nullptr) { *changedParameters = 0; }
+
+    s3km1110ConfigParameters target = desired;
+    target.detectionGatesMin = max((uint8_t)0, min((uint8_t)15, target.detectionGatesMin));
+    target.detectionGatesMax = max((uint8_t)0, min((uint8_t)15, target.detectionGatesMax));
+    if (target.detectionGatesMin > target.detectionGatesMax) { return false; }
+
+    const uint64_t allParameters = (1ULL << kConfigParameterCount) - 1;
+    uint64_t unconfirmed = allParameters & ~_radarConfigurationKnown;
+    uint64_t changed = 0;
+    bool isSessionOpen = false;
+    bool isSuccess = true;
+
+    if (unconfirmed != 0) {
+        // A value that was never confirmed most likely came from a default, writing it could silently change the radar
+        if (!isOverwritingUnconfirmed) { return false; }
+
+        isSessionOpen = _openCommandMode();
+        for (uint8_t idx = 0; idx < kConfigParameterCount && isSessionOpen; idx++) {
+            if (!(unconfirmed & (1ULL << idx))) { continue; }
+            if (_readParameterConfiguration(_configParameterCode(idx), true)) {
+                unconfirmed &= ~(1ULL << idx);
+            }
+        }
+
+        // Without every current value the write order of the gate range can not be chosen safely
+        if (unconfirmed != 0) {
+            _closeCommandMode();
+            return false;
+        }
+    }
+
+    // When the gate range grows, raise the maximum first, so the radar never sees minimum above maximum
+    bool isMaximumFirst = target.detectionGatesMax > _confirmedRadarConfiguration.detectionGatesMax;
+
+    for (uint8_t position = 0; position < kConfigParameterCount; position++) {
+        uint8_t idx = position;
+        if (isMaximumFirst && position < 2) { idx = 1 - position; }
+
+        uint64_t parameterBit = 1ULL << idx;
+        uint32_t value = _configParameterValue(target, idx);
+        if (_configParameterValue(_confirmedRadarConfiguration, idx) == value) { continue; }
+
+        // The session is opened lazily, so an up to date radar costs no round trips at all
+        if (!isSessionOpen) {
+            isSessionOpen = _openCommandMode();
+            if (!isSessionOpen) {
+                isSuccess = false;
+                break;
+            }
+        }
+
+        uint16_t parameterCode = _configParameterCode(idx);
+        _radarConfigurationKnown &= ~parameterBit;
+        if (_setParameterConfiguration(parameterCode, value, true) &&
+            _readParameterConfiguration(parameterCode, true) &&
+            _configParameterValue(_confirmedRadarConfiguration, idx) == value) {
+            changed |= parameterBit;
+        } else {
+            isSuccess = false;
+        }
+    }
+
+    if (isSessionOpen) { _closeCommandMode(); }
+
+    if (changedParameters != nullptr) { *changedParameters = changed; }
     return isSuccess;
 }
 
@@ -91,20 +162,36 @@ bool s3km1110::setRadarConfigurationTargetDisappearanceDelay(uint16_t delay)
 
 bool s3km1110::readRadarConfigMinimumGates()
 {
-    _lastRadarConfigCommand = ConfigParam::MinDistance;
-    return _sendCommandAndWait(RadarCommand::ReadConfig, static_cast<uint32_t>(ConfigParam::MinDistance), 2);
+    return _readParameterConfiguration(static_cast<uint16_t>(ConfigParam::MinDistance));
 }
 
 bool s3km1110::readRadarConfigMaximumGates()
 {
-    _lastRadarConfigCommand = ConfigParam::MaxDistance;
-    return _sendCommandAndWait(RadarCommand::ReadConfig, static_cast<uint32_t>(ConfigParam::MaxDistance), 2);
+    return _readParameterConfiguration(static_cast<uint16_t>(ConfigParam::MaxDistance));
 }
 
 bool s3km1110::readRadarConfigTargetDisappearanceDelay()
 {
-    _lastRadarConfigCommand = ConfigParam::DisappearanceDelay;
-    return _sendCommandAndWait(RadarCommand::ReadConfig, static_cast<uint32_t>(ConfigParam::DisappearanceDelay), 2);
+    return _readParameterConfiguration(static_cast<uint16_t>(ConfigParam::DisappearanceDelay));
+}
+
+bool s3km1110::readRadarConfigThresholds()
+{
+    if (!_openCommandMode()) {
+        _closeCommandMode();
+        return false;
+    }
+
+    bool isSuccess = true;
+    for (uint8_t gate = 0; gate < kDistanceGateCount && isSuccess; gate++) {
+        isSuccess =
+            _readParameterConfiguration(static_cast<uint16_t>(ConfigParam::MotionTriggerThreshold) + gate, true) &&
+            _readParameterConfiguration(static_cast<uint16_t>(ConfigParam::MotionHoldThreshold) + gate, true) &&
+            _readParameterConfiguration(static_cast<uint16_t>(ConfigParam::MicroMotionThreshold) + gate, true);
+    }
+
+    _closeCommandMode();
+    return isSuccess;
 }
 
 bool s3km1110::readAllRadarConfigs()
@@ -112,7 +199,8 @@ bool s3km1110::readAllRadarConfigs()
     return
         readRadarConfigMinimumGates() &&
         readRadarConfigMaximumGates() &&
-        readRadarConfigTargetDisappearanceDelay();
+        readRadarConfigTargetDisappearanceDelay() &&
+        readRadarConfigThresholds();
 }
 
 #pragma mark - Private
@@ -183,6 +271,35 @@ void s3km1110::_printCurrentFrame()
     #endif
 }
 
+void s3km1110::_writeDebugRecord(DebugRecordType type, const uint8_t *payload, uint8_t length)
+{
+    #ifdef S3KM1110_DEBUG_BINARY
+    if (_uartDebug == nullptr) { return; }
+
+    uint8_t idx = 0;
+    uint8_t buffer[kMaxFrameLength + 9];
+    buffer[idx++] = kDebugRecordSync1;
+    buffer[idx++] = kDebugRecordSync2;
+    buffer[idx++] = static_cast<uint8_t>(type);
+    buffer[idx++] = length + 4;
+    _writeLittleEndian(buffer, idx, millis(), 4);
+    for (uint8_t i = 0; i < length; i++) {
+        buffer[idx++] = payload[i];
+    }
+
+    uint8_t checksum = 0;
+    for (uint8_t i = 2; i < idx; i++) { checksum += buffer[i]; }
+    buffer[idx++] = checksum;
+
+    // One write per frame so the record goes out through the UART buffer without blocking the parser
+    _uartDebug->write(buffer, idx);
+    #else
+    (void)type;
+    (void)payload;
+    (void)length;
+    #endif
+}
+
 bool s3km1110::_isDataFrameComplete()
 {
     return 
@@ -221,6 +338,10 @@ bool s3km1110::_parseDataFrame()
     }
     #endif
 
+    #ifdef S3KM1110_DEBUG_BINARY_RAW
+    _writeDebugRecord(DebugRecordType::RawFrame, _radarDataFrame, _radarDataFramePosition);
+    #endif
+
     if (frame_data_length == 35) {
         uint8_t detectionResultRaw = _radarDataFrame[6];
         distanceToTarget = _radarDataFrame[7] + (_radarDataFrame[8] << 8);
@@ -239,7 +360,7 @@ bool s3km1110::_parseDataFrame()
 
         uint8_t distanceGateStart = 9;
         for (uint8_t idx = 0; idx < kDistanceGateCount; idx++) {
-            uint16_t energy = _radarDataFrame[distanceGateStart + idx] + (_radarDataFrame[distanceGateStart + idx + 1] << 8);
+            uint16_t energy = _radarDataFrame[distanceGateStart + idx * 2] + (_radarDataFrame[distanceGateStart + idx * 2 + 1] << 8);
             distanceGateEnergy[idx] = energy;
 
             #ifdef S3KM1110_DEBUG_DATA
@@ -254,6 +375,17 @@ bool s3km1110::_parseDataFrame()
         }
         #endif
 
+        #if defined(S3KM1110_DEBUG_BINARY) && !defined(S3KM1110_DEBUG_BINARY_RAW)
+        uint8_t recordIdx = 0;
+        uint8_t record[3 + kDistanceGateCount * 2];
+        record[recordIdx++] = isTargetDetected ? 0x01 : 0x00;
+        _writeLittleEndian(record, recordIdx, distanceToTarget, 2);
+        for (uint8_t idx = 0; idx < kDistanceGateCount; idx++) {
+            _writeLittleEndian(record, recordIdx, distanceGateEnergy[idx], 2);
+        }
+        _writeDebugRecord(DebugRecordType::DataFrame, record, recordIdx);
+        #endif
+
         return true;
     } else {
         #ifdef S3KM1110_DEBUG_DATA
@@ -366,26 +498,85 @@ bool s3km1110::_parseCommandFrame()
 bool s3km1110::_parseGetConfigCommandFrame(char *payload, uint8_t count)
 {
     if (count != 4) { return false; }
-    uint32_t result = payload[0] + (payload[1] << 8) + (payload[2] << 16) + (payload[3] << 24);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(payload);
+    uint32_t result = bytes[0] + (bytes[1] << 8) + (bytes[2] << 16) + ((uint32_t)bytes[3] << 24);
 
-    if (_lastRadarConfigCommand == ConfigParam::MinDistance) {
-        radarConfiguration.detectionGatesMin = result;
-    }
-    else if (_lastRadarConfigCommand == ConfigParam::MaxDistance) {
-        radarConfiguration.detectionGatesMax = result;
-    }
-    else if (_lastRadarConfigCommand == ConfigParam::DisappearanceDelay) {
-        radarConfiguration.targetDisappearanceDelay = result;
-    } else {
-        return false;
-    }
+    int8_t index = _configParameterIndex(static_cast<uint16_t>(_lastRadarConfigCommand));
+    if (index < 0) { return false; }
 
+    _confirmConfigParameter(index, result);
     return true;
 }
 
-bool s3km1110::_setParameterConfiguration(uint16_t parameterCode, int value)
+bool s3km1110::_setParameterConfiguration(uint16_t parameterCode, uint32_t value, bool isSkipCommandMode)
 {
-    return _sendCommandAndWait(static_cast<uint8_t>(RadarCommand::SetConfig), parameterCode, 2, value, 4);
+    return _sendCommandAndWait(static_cast<uint8_t>(RadarCommand::SetConfig), parameterCode, 2, value, 4, isSkipCommandMode);
+}
+
+bool s3km1110::_readParameterConfiguration(uint16_t parameterCode, bool isSkipCommandMode)
+{
+    _lastRadarConfigCommand = static_cast<ConfigParam>(parameterCode);
+    return _sendCommandAndWait(RadarCommand::ReadConfig, parameterCode, 2, isSkipCommandMode);
+}
+
+#pragma mark * Config parameter helpers
+
+void s3km1110::_confirmConfigParameter(uint8_t index, uint32_t value)
+{
+    _setConfigParameterValue(_confirmedRadarConfiguration, index, value);
+    _setConfigParameterValue(radarConfiguration, index, value);
+    _radarConfigurationKnown |= 1ULL << index;
+}
+
+// Index of a parameter in kConfig* bit order: min gates, max gates, delay, then 16 gates of each threshold
+int8_t s3km1110::_configParameterIndex(uint16_t parameterCode)
+{
+    if (parameterCode == static_cast<uint16_t>(ConfigParam::MinDistance)) { return 0; }
+    if (parameterCode == static_cast<uint16_t>(ConfigParam::MaxDistance)) { return 1; }
+    if (parameterCode == static_cast<uint16_t>(ConfigParam::DisappearanceDelay)) { return 2; }
+    if (parameterCode >= static_cast<uint16_t>(ConfigParam::MotionTriggerThreshold) &&
+        parameterCode < static_cast<uint16_t>(ConfigParam::MicroMotionThreshold) + kDistanceGateCount) {
+        uint8_t group = (parameterCode >> 4) - 1;
+        uint8_t gate = parameterCode & 0x0F;
+        return 3 + group * kDistanceGateCount + gate;
+    }
+    return -1;
+}
+
+uint16_t s3km1110::_configParameterCode(uint8_t index)
+{
+    if (index == 0) { return static_cast<uint16_t>(ConfigParam::MinDistance); }
+    if (index == 1) { return static_cast<uint16_t>(ConfigParam::MaxDistance); }
+    if (index == 2) { return static_cast<uint16_t>(ConfigParam::DisappearanceDelay); }
+    uint8_t group = (index - 3) / kDistanceGateCount;
+    uint8_t gate = (index - 3) % kDistanceGateCount;
+    return ((group + 1) << 4) + gate;
+}
+
+uint32_t s3km1110::_configParameterValue(const s3km1110ConfigParameters &config, uint8_t index)
+{
+    if (index == 0) { return config.detectionGatesMin; }
+    if (index == 1) { return config.detectionGatesMax; }
+    if (index == 2) { return config.targetDisappearanceDelay; }
+    uint8_t group = (index - 3) / kDistanceGateCount;
+    uint8_t gate = (index - 3) % kDistanceGateCount;
+    if (group == 0) { return config.motionTriggerThreshold[gate]; }
+    if (group == 1) { return config.motionHoldThreshold[gate]; }
+    return config.microMotionThreshold[gate];
+}
+
+void s3km1110::_setConfigParameterValue(s3km1110ConfigParameters &config, uint8_t index, uint32_t value)
+{
+    if (index == 0) { config.detectionGatesMin = value; }
+    else if (index == 1) { config.detectionGatesMax = value; }
+    else if (index == 2) { config.targetDisappearanceDelay = value; }
+    else {
+        uint8_t group = (index - 3) / kDistanceGateCount;
+        uint8_t gate = (index - 3) % kDistanceGateCount;
+        if (group == 0) { config.motionTriggerThreshold[gate] = value; }
+        else if (group == 1) { config.motionHoldThreshold[gate] = value; }
+        else { config.microMotionThreshold[gate] = value; }
+    }
 }
 
 #pragma mark - Command mode
@@ -473,4 +664,200 @@ bool s3km1110::_sendCommandAndWait(
     return false;
 }
 
+#pragma mark - Aggregator
+
+bool s3km1110Aggregator::begin(uint32_t windowDuration, uint32_t hopDuration)
+{
+    if (hopDuration == 0) { hopDuration = windowDuration; }
+    if (windowDuration == 0 || windowDuration % hopDuration != 0) { return false; }
+
+    uint32_t paneCount = windowDuration / hopDuration;
+    if (paneCount > kMaxWindowPanes) { return false; }
+
+    _paneCount = paneCount;
+    _hopDuration = hopDuration;
+    reset();
+    return true;
+}
+
+void s3km1110Aggregator::reset()
+{
+    for (uint8_t idx = 0; idx < kMaxWindowPanes; idx++) {
+        _clearPane(_panes[idx]);
+    }
+    _paneIndex = 0;
+    _filledPanes = 0;
+    _isStarted = false;
+    _pendingHead = 0;
+    _pendingCount = 0;
+    droppedSummaries = 0;
+    summary = s3km1110WindowSummary();
+}
+
+bool s3km1110Aggregator::update(const s3km1110 &radar)
+{
+    return update(radar, millis());
+}
+
+bool s3km1110Aggregator::update(const s3km1110 &radar, uint32_t now)
+{
+    if (_paneCount == 0) { return false; }
+
+    if (!_isStarted) {
+        _paneStart = now;
+        _isStarted = true;
+    }
+
+    _advance(now);
+
+    Pane &pane = _panes[_paneIndex];
+    pane.frames++;
+
+    for (uint8_t idx = 0; idx < s3km1110::kDistanceGateCount; idx++) {
+        uint16_t energy = radar.distanceGateEnergy[idx];
+        pane.gateMin[idx] = min(pane.gateMin[idx], energy);
+        pane.gateMax[idx] = max(pane.gateMax[idx], energy);
+        pane.gateSum[idx] += energy;
+        pane.gateSumSquares[idx] += (uint32_t)energy * energy;
+    }
+
+    if (radar.isTargetDetected && radar.distanceToTarget >= 0) {
+        int16_t distance = radar.distanceToTarget;
+        pane.presenceFrames++;
+        pane.distanceMin = min(pane.distanceMin, distance);
+        pane.distanceMax = max(pane.distanceMax, distance);
+        pane.distanceSum += distance;
+        pane.distanceSumSquares += (uint32_t)distance * distance;
+    }
+
+    return _popSummary();
+}
+
+bool s3km1110Aggregator::flush()
+{
+    return flush(millis());
+}
+
+bool s3km1110Aggregator::flush(uint32_t now)
+{
+    if (_paneCount == 0 || !_isStarted) { return false; }
+    _advance(now);
+    return _popSummary();
+}
+
+#pragma mark * Aggregator helpers
+
+void s3km1110Aggregator::_advance(uint32_t now)
+{
+    // Close every pane that ended before now. After a gap longer than the window all panes are empty,
+    // so closing more than _paneCount + 1 of them changes nothing and the start is just fast-forwarded.
+    uint32_t elapsedPanes = (now - _paneStart) / _hopDuration;
+    uint32_t panesToClose = min(elapsedPanes, (uint32_t)_paneCount + 1);
+    for (uint32_t idx = 0; idx < panesToClose; idx++) {
+        _closePane();
+        _paneStart += _hopDuration;
+    }
+    _paneStart += (elapsedPanes - panesToClose) * _hopDuration;
+}
+
+bool s3km1110Aggregator::_popSummary()
+{
+    if (_pendingCount == 0) { return false; }
+
+    summary = _pendingSummaries[_pendingHead];
+    _pendingHead = (_pendingHead + 1) % kMaxWindowPanes;
+    _pendingCount--;
+    return true;
+}
+
+void s3km1110Aggregator::_clearPane(Pane &pane)
+{
+    pane.frames = 0;
+    pane.presenceFrames = 0;
+    pane.distanceMin = INT16_MAX;
+    pane.distanceMax = -1;
+    pane.distanceSum = 0;
+    pane.distanceSumSquares = 0;
+    for (uint8_t idx = 0; idx < s3km1110::kDistanceGateCount; idx++) {
+        pane.gateMin[idx] = UINT16_MAX;
+        pane.gateMax[idx] = 0;
+        pane.gateSum[idx] = 0;
+        pane.gateSumSquares[idx] = 0;
+    }
+}
+
+void s3km1110Aggregator::_closePane()
+{
+    if (_filledPanes < _paneCount) { _filledPanes++; }
+    if (_filledPanes == _paneCount) { _buildSummary(); }
+
+    _paneIndex = (_paneIndex + 1) % _paneCount;
+    _clearPane(_panes[_paneIndex]);
+}
+
+void s3km1110Aggregator::_buildSummary()
+{
+    uint32_t frames = 0;
+    uint32_t presenceFrames = 0;
+    for (uint8_t idx = 0; idx < _paneCount; idx++) {
+        frames += _panes[idx].frames;
+        presenceFrames += _panes[idx].presenceFrames;
+    }
+    if (frames == 0) { return; }    // Every pane of the window is empty
+
+    if (_pendingCount == kMaxWindowPanes) {
+        _pendingHead = (_pendingHead + 1) % kMaxWindowPanes;
+        _pendingCount--;
+        droppedSummaries++;
+    }
+
+    s3km1110WindowSummary &result = _pendingSummaries[(_pendingHead + _pendingCount) % kMaxWindowPanes];
+    _pendingCount++;
+
+    result = s3km1110WindowSummary();
+    result.windowDuration = _hopDuration * _paneCount;
+    result.windowStart = _paneStart + _hopDuration - result.windowDuration;
+    result.frameCount = frames;
+    result.presenceFrameCount = presenceFrames;
+    result.presenceDutyCycle = (float)presenceFrames / frames;
+
+    if (presenceFrames > 0) {
+        int16_t distanceMin = INT16_MAX;
+        int16_t distanceMax = -1;
+        uint64_t distanceSum = 0;
+        uint64_t distanceSumSquares = 0;
+        for (uint8_t idx = 0; idx < _paneCount; idx++) {
+            const Pane &pane = _panes[idx];
+            distanceMin = min(distanceMin, pane.distanceMin);
+            distanceMax = max(distanceMax, pane.distanceMax);
+            distanceSum += pane.distanceSum;
+            distanceSumSquares += pane.distanceSumSquares;
+        }
+        double mean = (double)distanceSum / presenceFrames;
+        result.distanceMin = distanceMin;
+        result.distanceMax = distanceMax;
+        result.distanceMean = (int16_t)(mean + 0.5);
+        result.distanceVariance = max(0.0, (double)distanceSumSquares / presenceFrames - mean * mean);
+    }
+
+    for (uint8_t gate = 0; gate < s3km1110::kDistanceGateCount; gate++) {
+        uint16_t gateMin = UINT16_MAX;
+        uint16_t gateMax = 0;
+        uint64_t gateSum = 0;
+        uint64_t gateSumSquares = 0;
+        for (uint8_t idx = 0; idx < _paneCount; idx++) {
+            const Pane &pane = _panes[idx];
+            gateMin = min(gateMin, pane.gateMin[gate]);
+            gateMax = max(gateMax, pane.gateMax[gate]);
+            gateSum += pane.gateSum[gate];
+            gateSumSquares += pane.gateSumSquares[gate];
+        }
+        double mean = (double)gateSum / frames;
+        result.gates[gate].min = gateMin;
+        result.gates[gate].max = gateMax;
+        result.gates[gate].mean = (uint16_t)(mean + 0.5);
+        result.gates[gate].variance = max(0.0, (double)gateSumSquares / frames - mean * mean);
+    }
+}
+
 #endif //s3km1110_cpp
\ No newline at end of file
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Decode binary debug records written by the s3km1110 library.
+
+Build the firmware with S3KM1110_DEBUG_BINARY (decoded values) or
+S3KM1110_DEBUG_BINARY_RAW (raw frame bytes), then feed the debug stream here:
+
+    python3 s3km1110_decode.py /dev/ttyUSB0            # needs pyserial
+    python3 s3km1110_decode.py capture.bin
+    cat capture.bin | python3 s3km1110_decode.py -
+
+Record layout: A5 5A | type | length | payload[length] | checksum
+The checksum is the sum of type, length and payload bytes (mod 256).
+Every payload starts with millis() as u32 little-endian.
+Text written to the same stream (e.g. command debug) is skipped.
+"""
+
+import argparse
+import struct
+import sys
+
+SYNC = b"\xA5\x5A"
+RECORD_DATA_FRAME = 0x01
+RECORD_RAW_FRAME = 0x02
+GATE_COUNT = 16
+
+
+def format_gates(gates):
+    return " ".join(str(energy) for energy in gates)
+
+
+def decode_data_frame(body):
+    detected, distance = struct.unpack_from("<Bh", body, 0)
+    gates = struct.unpack_from("<%dH" % GATE_COUNT, body, 3)
+    return "detected=%u distance=%d gates=[%s]" % (detected, distance, format_gates(gates))
+
+
+def decode_raw_frame(body):
+    text = "raw=%s" % body.hex(" ")
+    # F4 F3 F2 F1 | length u16 | detected u8 | distance u16 | gate energy u16 x 16 | F8 F7 F6 F5
+    # Distance is decoded signed, as the driver stores it in distanceToTarget (int16_t)
+    if len(body) == 45 and body[:4] == b"\xF4\xF3\xF2\xF1":
+        detected, distance = struct.unpack_from("<Bh", body, 6)
+        gates = struct.unpack_from("<%dH" % GATE_COUNT, body, 9)
+        text += " | detected=%u distance=%d gates=[%s]" % (detected, distance, format_gates(gates))
+    return text
+
+
+def decode_record(record_type, payload):
+    timestamp = struct.unpack_from("<I", payload, 0)[0]
+    body = payload[4:]
+    if record_type == RECORD_DATA_FRAME and len(body) == 3 + GATE_COUNT * 2:
+        return "%10u DTA %s" % (timestamp, decode_data_frame(body))
+    if record_type == RECORD_RAW_FRAME:
+        return "%10u RAW %s" % (timestamp, decode_raw_frame(body))
+    return "%10u ??? type=0x%02x %s" % (timestamp, record_type, body.hex(" "))
+
+
+def records(buffer):
+    """Yield decoded records from buffer, returns the unconsumed tail via StopIteration value."""
+    position = 0
+    while True:
+        start = buffer.find(SYNC, position)
+        if start < 0:
+            return buffer[-1:] if buffer.endswith(SYNC[:1]) else b""
+        if start + 4 > len(buffer):
+            return buffer[start:]
+
+        record_type, length = buffer[start + 2], buffer[start + 3]
+        end = start + 4 + length + 1
+        if end > len(buffer):
+            return buffer[start:]
+
+        payload = buffer[start + 4:end - 1]
+        checksum = (record_type + length + sum(payload)) & 0xFF
+        if length < 4 or checksum != buffer[end - 1]:
+            position = start + 1    # False sync inside text or a corrupted record, resync
+            continue
+
+        yield decode_record(record_type, payload)
+        position = end
+
+
+def open_input(source, baudrate):
+    if source == "-":
+        return sys.stdin.buffer
+    if source.startswith("/dev/") or source.upper().startswith("COM"):
+        import serial  # pyserial
+        return serial.Serial(source, baudrate, timeout=0.1)
+    return open(source, "rb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode s3km1110 binary debug records")
+    parser.add_argument("source", help="serial port, capture file or '-' for stdin")
+    parser.add_argument("-b", "--baudrate", type=int, default=115200)
+    args = parser.parse_args()
+
+    stream = open_input(args.source, args.baudrate)
+    pending = b""
+    is_file = not hasattr(stream, "in_waiting")
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            if is_file:
+                break
+            continue
+
+        pending += chunk
+        decoder = records(pending)
+        while True:
+            try:
+                print(next(decoder), flush=True)
+            except StopIteration as tail:
+                pending = tail.value
+                break
+
+
+if __name__ == "__main__":
+    main()